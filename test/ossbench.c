@@ -0,0 +1,616 @@
+/*
+ * ossbench - scripted benchmark for the OSS PCM emulation
+ *
+ * Measures the accuracy of SNDCTL_DSP_GETODELAY against the wall clock,
+ * the jitter of SNDCTL_DSP_GETOPTR, the CPU cost of write() per fragment
+ * size and the cost of the plugin chain per format/rate combination.
+ *
+ * Each result is printed as one line of key=value pairs.  The exit code
+ * is 1 when a self-check failed and 2 on errors, so the program can be
+ * driven from scripts (see ossbench.sh) against snd-dummy and snd-aloop.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/soundcard.h>
+
+#ifndef AFMT_S32_LE
+#define AFMT_S32_LE	0x00001000
+#endif
+
+struct fmt_desc {
+	const char *name;
+	int afmt;
+	int bytes;
+};
+
+static const struct fmt_desc formats[] = {
+	{ "S16_LE", AFMT_S16_LE, 2 },	/* first entry is the reference format */
+	{ "U8", AFMT_U8, 1 },
+	{ "S16_BE", AFMT_S16_BE, 2 },
+	{ "U16_LE", AFMT_U16_LE, 2 },
+	{ "MU_LAW", AFMT_MU_LAW, 1 },
+	{ "A_LAW", AFMT_A_LAW, 1 },
+	{ "S32_LE", AFMT_S32_LE, 4 },
+};
+
+#define NUM_FORMATS	(sizeof(formats) / sizeof(formats[0]))
+
+static const int rates[] = { 8000, 11025, 22050, 44100, 48000 };
+
+#define NUM_RATES	(sizeof(rates) / sizeof(rates[0]))
+
+#define REF_RATE	48000
+#define REF_CHANNELS	2
+#define REF_FRAGSHIFT	12
+#define MIN_FRAGSHIFT	8
+#define MAX_FRAGSHIFT	14
+
+struct stream {
+	int fd;
+	const struct fmt_desc *fmt;
+	int channels;
+	int rate;
+	int frame_bytes;
+	int fragsize;
+	int fragstotal;
+	long long written;
+	char *buf;
+	char hw[128];
+};
+
+static const char *device = "/dev/dsp";
+static const char *hw_params_proc;	/* /proc/asound/cardX/pcm0p/sub0/hw_params */
+static const char *label = "default";
+static FILE *out;
+static int duration_ms = 1000;
+static int poll_us = 1000;
+static int odelay_tolerance;		/* frames, 0 = one fragment */
+static int jitter_limit_us;		/* 0 = two fragments */
+static int failed;
+
+static double now(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void emit(const char *test, const struct stream *st, const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(out, "test=%s card=%s fmt=%s rate=%d channels=%d fragsize=%d",
+		test, label, st->fmt->name, st->rate, st->channels,
+		st->fragsize);
+	if (st->hw[0])
+		fprintf(out, " %s", st->hw);
+	va_start(ap, fmt);
+	if (*fmt)
+		fputc(' ', out);
+	vfprintf(out, fmt, ap);
+	va_end(ap);
+	fputc('\n', out);
+	fflush(out);
+}
+
+/*
+ * read back what the OSS emulation programmed into the hardware,
+ * to tell which combinations went through the plugin chain
+ */
+static void read_hw_params(struct stream *st)
+{
+	char line[128], fmt[32] = "";
+	int rate = 0, channels = 0;
+	FILE *f;
+
+	st->hw[0] = 0;
+	if (!hw_params_proc)
+		return;
+	f = fopen(hw_params_proc, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, "format: ", 8))
+			sscanf(line + 8, "%31s", fmt);
+		else if (!strncmp(line, "rate: ", 6))
+			rate = atoi(line + 6);
+		else if (!strncmp(line, "channels: ", 10))
+			channels = atoi(line + 10);
+	}
+	fclose(f);
+	if (!fmt[0])
+		return;
+	snprintf(st->hw, sizeof(st->hw),
+		 "hw_fmt=%s hw_rate=%d hw_channels=%d plugin=%s",
+		 fmt, rate, channels,
+		 strcmp(fmt, st->fmt->name) || rate != st->rate ||
+		 channels != st->channels ? "yes" : "no");
+}
+
+/* returns 0 on success, 1 if the parameters are not accepted, -1 on error */
+static int stream_open(struct stream *st, const struct fmt_desc *fmt,
+		       int channels, int rate, int fragshift)
+{
+	audio_buf_info info;
+	int val;
+
+	memset(st, 0, sizeof(*st));
+	st->fmt = fmt;
+	st->channels = channels;
+	st->rate = rate;
+	st->fd = open(device, O_WRONLY);
+	if (st->fd < 0) {
+		perror(device);
+		return -1;
+	}
+	val = 0x7fff0000 | fragshift;
+	if (ioctl(st->fd, SNDCTL_DSP_SETFRAGMENT, &val) < 0) {
+		perror("SNDCTL_DSP_SETFRAGMENT");
+		goto __error;
+	}
+	val = fmt->afmt;
+	if (ioctl(st->fd, SNDCTL_DSP_SETFMT, &val) < 0 || val != fmt->afmt)
+		goto __skip;
+	val = channels;
+	if (ioctl(st->fd, SNDCTL_DSP_CHANNELS, &val) < 0 || val != channels)
+		goto __skip;
+	val = rate;
+	if (ioctl(st->fd, SNDCTL_DSP_SPEED, &val) < 0 || val <= 0)
+		goto __skip;
+	st->rate = val;
+	if (ioctl(st->fd, SNDCTL_DSP_GETOSPACE, &info) < 0) {
+		perror("SNDCTL_DSP_GETOSPACE");
+		goto __error;
+	}
+	st->fragsize = info.fragsize;
+	st->fragstotal = info.fragstotal;
+	st->frame_bytes = fmt->bytes * channels;
+	st->buf = calloc(1, st->fragsize);
+	if (!st->buf) {
+		fprintf(stderr, "no memory\n");
+		goto __error;
+	}
+	return 0;
+
+ __skip:
+	close(st->fd);
+	emit("open", st, "status=skip");
+	return 1;
+ __error:
+	close(st->fd);
+	return -1;
+}
+
+static void stream_close(struct stream *st)
+{
+	/* drop the pending data instead of waiting for the drain */
+	ioctl(st->fd, SNDCTL_DSP_RESET, 0);
+	close(st->fd);
+	free(st->buf);
+}
+
+static int write_frag(struct stream *st)
+{
+	ssize_t res;
+	int done = 0;
+
+	while (done < st->fragsize) {
+		res = write(st->fd, st->buf + done, st->fragsize - done);
+		if (res < 0) {
+			perror("write");
+			return -1;
+		}
+		done += res;
+	}
+	st->written += done;
+	return 0;
+}
+
+/* fill the whole buffer so that the following writes run in steady state */
+static int stream_prime(struct stream *st)
+{
+	audio_buf_info info;
+
+	do {
+		if (write_frag(st) < 0)
+			return -1;
+		if (ioctl(st->fd, SNDCTL_DSP_GETOSPACE, &info) < 0) {
+			perror("SNDCTL_DSP_GETOSPACE");
+			return -1;
+		}
+	} while (info.fragments > 0);
+	read_hw_params(st);
+	return 0;
+}
+
+/*
+ * compare GETODELAY against a wall-clock model of the stream: the model
+ * position is anchored where the pointer is first seen moving, and the
+ * expected delay is the written bytes minus what should have been played
+ * since then.  The delay can never exceed the buffer either.
+ */
+static int check_odelay(const struct fmt_desc *fmt, int channels, int rate)
+{
+	struct stream st;
+	struct count_info ci;
+	audio_buf_info info;
+	struct timespec nap = { 0, poll_us * 1000 };
+	double t, t_start = 0, end, wait_end, bps, err, max_err = 0, sum_err = 0;
+	int odelay, tolerance, samples = 0, overflow = 0, res;
+
+	res = stream_open(&st, fmt, channels, rate, REF_FRAGSHIFT);
+	if (res)
+		return res < 0 ? -1 : 0;
+	bps = (double)st.rate * st.frame_bytes;
+	/* the stream gets one duration to start moving, then the test fails */
+	wait_end = now(CLOCK_MONOTONIC) + duration_ms / 1000.0;
+	end = 0;
+	for (;;) {
+		if (ioctl(st.fd, SNDCTL_DSP_GETOSPACE, &info) < 0) {
+			perror("SNDCTL_DSP_GETOSPACE");
+			goto __error;
+		}
+		for (; info.fragments > 0; info.fragments--)
+			if (write_frag(&st) < 0)
+				goto __error;
+		if (!end) {
+			if (ioctl(st.fd, SNDCTL_DSP_GETOPTR, &ci) < 0) {
+				perror("SNDCTL_DSP_GETOPTR");
+				goto __error;
+			}
+			t = now(CLOCK_MONOTONIC);
+			if (!ci.bytes) {
+				if (t >= wait_end)
+					break;
+				nanosleep(&nap, NULL);
+				continue;
+			}
+			t_start = t - (unsigned int)ci.bytes / bps;
+			end = t + duration_ms / 1000.0;
+		}
+		if (ioctl(st.fd, SNDCTL_DSP_GETODELAY, &odelay) < 0) {
+			perror("SNDCTL_DSP_GETODELAY");
+			goto __error;
+		}
+		t = now(CLOCK_MONOTONIC);
+		if (t >= end)
+			break;
+		if (odelay > st.fragsize * st.fragstotal)
+			overflow++;
+		err = (odelay - (st.written - bps * (t - t_start))) /
+			st.frame_bytes;
+		if (fabs(err) > max_err)
+			max_err = fabs(err);
+		sum_err += err;
+		samples++;
+		nanosleep(&nap, NULL);
+	}
+	read_hw_params(&st);
+	/* the pointer may advance in whole fragments, polled every poll_us */
+	tolerance = odelay_tolerance ? odelay_tolerance :
+		st.fragsize / st.frame_bytes + (int)(st.rate * (poll_us / 1e6)) + 1;
+	res = !samples || overflow || max_err > tolerance;
+	emit("odelay", &st,
+	     "samples=%d overflow=%d max_err_frames=%.0f mean_err_frames=%.1f limit_frames=%d status=%s",
+	     samples, overflow, max_err, samples ? sum_err / samples : 0.0,
+	     tolerance, res ? "fail" : "ok");
+	failed |= res;
+	stream_close(&st);
+	return 0;
+
+ __error:
+	stream_close(&st);
+	return -1;
+}
+
+/*
+ * besides the reference setup, check some combinations which need
+ * conversions on snd-dummy, where the byte <-> frame accounting of the
+ * plugin chain can go wrong
+ */
+static const struct {
+	int fmt;	/* index in formats[] */
+	int channels;
+	int rate;
+} odelay_setups[] = {
+	{ 0, REF_CHANNELS, REF_RATE },	/* S16_LE */
+	{ 1, 1, 11025 },		/* U8 */
+	{ 2, 2, 44100 },		/* S16_BE */
+	{ 4, 1, 8000 },			/* MU_LAW */
+	{ 6, 2, 22050 },		/* S32_LE */
+};
+
+#define NUM_ODELAY_SETUPS	(sizeof(odelay_setups) / sizeof(odelay_setups[0]))
+
+static int test_odelay(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_ODELAY_SETUPS; i++)
+		if (check_odelay(&formats[odelay_setups[i].fmt],
+				 odelay_setups[i].channels,
+				 odelay_setups[i].rate) < 0)
+			return -1;
+	return 0;
+}
+
+/*
+ * sample GETOPTR while keeping the buffer filled and compare it against
+ * a least-squares line; the residuals are the pointer jitter
+ */
+static int test_optr(void)
+{
+	struct stream st;
+	struct count_info ci;
+	audio_buf_info info;
+	struct timespec nap = { 0, poll_us * 1000 };
+	double *t, *pos, t0, end, wait_end, st_t = 0, st_p = 0, stt = 0, stp = 0;
+	double slope, icpt, r, max_r = 0, sum_r2 = 0, bps, limit;
+	int i, n = 0, cap, backwards = 0, res;
+
+	res = stream_open(&st, &formats[0], REF_CHANNELS, REF_RATE, REF_FRAGSHIFT);
+	if (res)
+		return res < 0 ? -1 : 0;
+	cap = (long long)duration_ms * 1000 / poll_us + 16;
+	t = malloc(cap * sizeof(*t));
+	pos = malloc(cap * sizeof(*pos));
+	if (!t || !pos) {
+		fprintf(stderr, "no memory\n");
+		goto __error;
+	}
+	if (stream_prime(&st) < 0)
+		goto __error;
+	/* the stream gets one duration to start moving, then the test fails */
+	wait_end = now(CLOCK_MONOTONIC) + duration_ms / 1000.0;
+	end = 0;
+	while (n < cap) {
+		if (ioctl(st.fd, SNDCTL_DSP_GETOSPACE, &info) < 0) {
+			perror("SNDCTL_DSP_GETOSPACE");
+			goto __error;
+		}
+		for (; info.fragments > 0; info.fragments--)
+			if (write_frag(&st) < 0)
+				goto __error;
+		if (ioctl(st.fd, SNDCTL_DSP_GETOPTR, &ci) < 0) {
+			perror("SNDCTL_DSP_GETOPTR");
+			goto __error;
+		}
+		t[n] = now(CLOCK_MONOTONIC);
+		if (end && t[n] >= end)
+			break;
+		pos[n] = (unsigned int)ci.bytes;
+		/* wait until the stream is really running */
+		if (!n && !pos[n]) {
+			if (t[n] >= wait_end)
+				break;
+		} else {
+			if (!n)
+				end = t[n] + duration_ms / 1000.0;
+			if (n && pos[n] < pos[n - 1])
+				backwards++;
+			n++;
+		}
+		nanosleep(&nap, NULL);
+	}
+	if (n < 2) {
+		emit("optr", &st, "samples=%d status=fail", n);
+		failed = 1;
+		goto __out;
+	}
+	t0 = t[0];
+	for (i = 0; i < n; i++) {
+		t[i] -= t0;
+		st_t += t[i];
+		st_p += pos[i];
+		stt += t[i] * t[i];
+		stp += t[i] * pos[i];
+	}
+	slope = (n * stp - st_t * st_p) / (n * stt - st_t * st_t);
+	icpt = (st_p - slope * st_t) / n;
+	bps = (double)st.rate * st.frame_bytes;
+	for (i = 0; i < n; i++) {
+		r = fabs(pos[i] - (icpt + slope * t[i])) / bps * 1e6;
+		if (r > max_r)
+			max_r = r;
+		sum_r2 += r * r;
+	}
+	limit = jitter_limit_us ? jitter_limit_us :
+		2.0 * st.fragsize / bps * 1e6;
+	res = backwards || max_r > limit;
+	emit("optr", &st,
+	     "samples=%d backwards=%d rate_ppm=%.0f max_jitter_us=%.1f rms_jitter_us=%.1f limit_us=%.0f status=%s",
+	     n, backwards, (slope / bps - 1.0) * 1e6, max_r,
+	     sqrt(sum_r2 / n), limit, res ? "fail" : "ok");
+	failed |= res;
+ __out:
+	free(t);
+	free(pos);
+	stream_close(&st);
+	return 0;
+
+ __error:
+	free(t);
+	free(pos);
+	stream_close(&st);
+	return -1;
+}
+
+/* CPU time (user + system) spent in write() in steady state */
+static int measure_writes(struct stream *st, int *writes, double *cpu_ns)
+{
+	double end, c0;
+	long long start;
+
+	if (stream_prime(st) < 0)
+		return -1;
+	*writes = 0;
+	start = st->written;
+	c0 = now(CLOCK_THREAD_CPUTIME_ID);
+	end = now(CLOCK_MONOTONIC) + duration_ms / 1000.0;
+	while (now(CLOCK_MONOTONIC) < end) {
+		if (write_frag(st) < 0)
+			return -1;
+		(*writes)++;
+	}
+	*cpu_ns = (now(CLOCK_THREAD_CPUTIME_ID) - c0) * 1e9;
+	st->written -= start;	/* bytes written while measuring */
+	return 0;
+}
+
+static int test_write(void)
+{
+	struct stream st;
+	double cpu_ns;
+	int shift, writes, res;
+
+	for (shift = MIN_FRAGSHIFT; shift <= MAX_FRAGSHIFT; shift++) {
+		res = stream_open(&st, &formats[0], REF_CHANNELS, REF_RATE, shift);
+		if (res < 0)
+			return -1;
+		if (res > 0)
+			continue;
+		if (measure_writes(&st, &writes, &cpu_ns) < 0) {
+			stream_close(&st);
+			return -1;
+		}
+		emit("write", &st,
+		     "writes=%d cpu_ns_per_write=%.0f cpu_ns_per_kib=%.0f status=ok",
+		     writes, writes ? cpu_ns / writes : 0.0,
+		     st.written ? cpu_ns * 1024 / st.written : 0.0);
+		stream_close(&st);
+	}
+	return 0;
+}
+
+static int test_plugin(void)
+{
+	struct stream st;
+	double cpu_ns, secs;
+	unsigned int f, r;
+	int channels, writes, res;
+
+	for (f = 0; f < NUM_FORMATS; f++) {
+		for (r = 0; r < NUM_RATES; r++) {
+			for (channels = 1; channels <= 2; channels++) {
+				res = stream_open(&st, &formats[f], channels,
+						  rates[r], REF_FRAGSHIFT);
+				if (res < 0)
+					return -1;
+				if (res > 0)
+					continue;
+				if (measure_writes(&st, &writes, &cpu_ns) < 0) {
+					stream_close(&st);
+					return -1;
+				}
+				secs = (double)st.written /
+					((double)st.rate * st.frame_bytes);
+				emit("plugin", &st,
+				     "writes=%d cpu_ns_per_sec=%.0f status=ok",
+				     writes, secs > 0 ? cpu_ns / secs : 0.0);
+				stream_close(&st);
+			}
+		}
+	}
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	int (*func)(void);
+} tests[] = {
+	{ "odelay", test_odelay },
+	{ "optr", test_optr },
+	{ "write", test_write },
+	{ "plugin", test_plugin },
+};
+
+#define NUM_TESTS	(sizeof(tests) / sizeof(tests[0]))
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: ossbench [options] [test...]\n"
+		"  tests: odelay optr write plugin (default: all)\n"
+		"  -d DEV    OSS PCM device (default /dev/dsp)\n"
+		"  -p FILE   hw_params proc file of the device\n"
+		"  -l LABEL  card label printed in the results\n"
+		"  -o FILE   write the results to FILE\n"
+		"  -D MSEC   duration of each measurement (default 1000)\n"
+		"  -i USEC   GETOPTR poll interval (default 1000)\n"
+		"  -e FRAMES max. GETODELAY error (default one fragment)\n"
+		"  -J USEC   max. GETOPTR jitter (default two fragments)\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	int c, j;
+
+	out = stdout;
+	while ((c = getopt(argc, argv, "d:p:l:o:D:i:e:J:h")) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'p':
+			hw_params_proc = optarg;
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				perror(optarg);
+				return 2;
+			}
+			break;
+		case 'D':
+			duration_ms = atoi(optarg);
+			break;
+		case 'i':
+			poll_us = atoi(optarg);
+			break;
+		case 'e':
+			odelay_tolerance = atoi(optarg);
+			break;
+		case 'J':
+			jitter_limit_us = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (duration_ms <= 0 || poll_us <= 0 || poll_us >= 1000000)
+		usage();
+	for (j = optind; j < argc; j++) {
+		for (i = 0; i < NUM_TESTS; i++)
+			if (!strcmp(argv[j], tests[i].name))
+				break;
+		if (i >= NUM_TESTS)
+			usage();
+	}
+
+	for (i = 0; i < NUM_TESTS; i++) {
+		if (optind < argc) {
+			for (j = optind; j < argc; j++)
+				if (!strcmp(argv[j], tests[i].name))
+					break;
+			if (j >= argc)
+				continue;
+		}
+		if (tests[i].func() < 0)
+			return 2;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+#!/bin/sh
+#
+# Run the OSS PCM emulation benchmark (ossbench) against snd-dummy and
+# snd-aloop, and optionally check the CPU cost figures against a baseline
+# result file from a previous run.
+#
+# usage: ossbench.sh [-o results] [-b baseline] [-T percent] [-- ossbench options]
+#
+# Extra module options can be given via DUMMY_OPTS and ALOOP_OPTS, e.g.
+# DUMMY_OPTS="model=ac97" restricts snd-dummy to S16_LE, 2 channels and
+# 48kHz so that every other combination runs through the plugin chain.
+# The options need a fresh module load, so the script bails out when the
+# module is already loaded.  The snd-dummy results are labelled with the
+# model in use (e.g. card=dummy-ac97) to keep baselines apart.
+#
+
+OSSBENCH=${OSSBENCH:-`dirname $0`/ossbench}
+results=ossbench.results
+baseline=
+tolerance=10
+
+usage() {
+	echo "usage: $0 [-o results] [-b baseline] [-T percent] [-- ossbench options]"
+	exit 2
+}
+
+while getopts "o:b:T:h" opt; do
+	case $opt in
+	o) results=$OPTARG ;;
+	b) baseline=$OPTARG ;;
+	T) tolerance=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift `expr $OPTIND - 1`
+
+if [ ! -x "$OSSBENCH" ]; then
+	echo "$OSSBENCH not found, run make first"
+	exit 2
+fi
+
+load_module() {
+	name=`echo $1 | tr - _`
+	if grep -q "^$name " /proc/modules; then
+		if [ $# -gt 1 ]; then
+			shift
+			echo "$name is already loaded, unload it to apply \"$*\""
+			exit 2
+		fi
+		return 0
+	fi
+	modprobe "$@" || exit 2
+}
+
+# print the snd-dummy model of the first card, as it decides which
+# combinations need the plugin chain
+dummy_model() {
+	model=`cut -d, -f1 /sys/module/snd_dummy/parameters/model 2>/dev/null`
+	case "$model" in
+	""|"(null)") echo default ;;
+	*) echo $model ;;
+	esac
+}
+
+# print the index of the card with the given id
+card_index() {
+	sed -n "s/^ *\([0-9]*\) \[$1 *\]:.*/\1/p" /proc/asound/cards
+}
+
+load_module snd-pcm-oss
+load_module snd-dummy $DUMMY_OPTS
+load_module snd-aloop $ALOOP_OPTS
+
+: > "$results"
+status=0
+for card in Dummy:dummy-`dummy_model` Loopback:aloop; do
+	id=${card%%:*}
+	label=${card##*:}
+	idx=`card_index $id`
+	if [ -z "$idx" ]; then
+		echo "card $id not found"
+		exit 2
+	fi
+	dev=/dev/dsp
+	[ $idx -gt 0 ] && dev=/dev/dsp$idx
+	echo "running on $label ($dev)"
+	"$OSSBENCH" -d $dev -p /proc/asound/card$idx/pcm0p/sub0/hw_params \
+		-l $label "$@" >> "$results"
+	res=$?
+	[ $res -gt $status ] && status=$res
+done
+
+if [ $status -ne 0 ]; then
+	grep "status=fail" "$results"
+	echo "self-check failed (exit code $status)"
+fi
+
+if [ -n "$baseline" ]; then
+	awk -v tol="$tolerance" '
+	function parse(   i, p) {
+		split("", f)
+		for (i = 1; i <= NF; i++) {
+			p = index($i, "=")
+			if (p)
+				f[substr($i, 1, p - 1)] = substr($i, p + 1)
+		}
+		key = f["test"] " " f["card"] " " f["fmt"] " " f["rate"] " " \
+			f["channels"] " " f["fragsize"]
+		if ("cpu_ns_per_sec" in f)
+			cost = f["cpu_ns_per_sec"] + 0
+		else if ("cpu_ns_per_write" in f)
+			cost = f["cpu_ns_per_write"] + 0
+		else
+			cost = -1
+	}
+	NR == FNR { parse(); if (cost >= 0) base[key] = cost; next }
+	{
+		parse()
+		if (cost < 0 || !(key in base))
+			next
+		if (cost > base[key] * (1 + tol / 100)) {
+			printf "regression: %s: %d -> %d ns\n", key, base[key], cost
+			bad = 1
+		}
+	}
+	END { exit bad }' "$baseline" "$results" || { [ $status -lt 1 ] && status=1; }
+fi
+
+exit $status
@@ -447,6 +447,9 @@ cat /proc/asound/card*/codec97\#0/ac97\#0-0+regs > $TEMPDIR/alsa-ac97-regs.tmp 2
 #Check for USB mixer setup
 cat /proc/asound/card*/usbmixer > $TEMPDIR/alsa-usbmixer.tmp 2> /dev/null
 
+#Check for USB stream and endpoint setup
+cat /proc/asound/card*/stream* > $TEMPDIR/alsa-usbstream.tmp 2> /dev/null
+
 #Fetch the info, and put it in $FILE in a nice readable format.
 if [[ -z $PASTEBIN ]]; then
 echo "upload=true&script=true&cardinfo=" > $FILE
@@ -625,6 +628,18 @@ then
 	echo "" >> $FILE
 fi
 
+if [ -s "$TEMPDIR/alsa-usbstream.tmp" ]
+then
+        echo "!!USB Stream information" >> $FILE
+        echo "!!----------------------" >> $FILE
+        echo "--startcollapse--" >> $FILE
+        echo "" >> $FILE
+        cat $TEMPDIR/alsa-usbstream.tmp >> $FILE
+        echo "--endcollapse--" >> $FILE
+	echo "" >> $FILE
+	echo "" >> $FILE
+fi
+
 #If no command line options are specified, then run as though --with-all was specified
 if [[ -z "$1" ]]
 then